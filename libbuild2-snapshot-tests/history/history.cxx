@@ -0,0 +1,129 @@
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+
+#include <libbuild2/snapshot/history.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace build2;
+using namespace build2::snapshot;
+
+static git_snapshot_record
+record (const string& ref,
+        uint64_t time,
+        bool changed,
+        optional<uint64_t> update_time,
+        optional<uint64_t> output_size,
+        const string& compiler = "gcc 13.2.0",
+        uint64_t jobs = 8)
+{
+  git_snapshot_record r;
+  r.ref = ref;
+  r.time = time;
+  r.metrics.target = "hello/exe{hello}";
+  r.metrics.changed = changed;
+  r.metrics.update_time = update_time;
+  r.metrics.output_size = output_size;
+  r.metrics.compiler = compiler;
+  r.metrics.jobs = jobs;
+  return r;
+}
+
+int
+main ()
+{
+  // Trailers round-trip.
+  //
+  {
+    build_metrics m;
+    m.target = "hello/exe{hello}";
+    m.changed = true;
+    m.wall_time = 5321;
+    m.update_time = 4210;
+    m.output_size = 1048576;
+    m.compiler = "gcc 13.2.0";
+    m.jobs = 8;
+
+    string msg ("exe{hello} snapshot\n");
+    for (const string& t: m.to_trailers ())
+      msg += '\n' + t;
+
+    assert (msg.find ("\nBuild-Update-Time: 4210ms") != string::npos);
+
+    build_metrics r (build_metrics::from_message (msg));
+
+    assert (r.target == m.target);
+    assert (r.changed);
+    assert (r.wall_time && *r.wall_time == 5321);
+    assert (r.update_time && *r.update_time == 4210);
+    assert (r.output_size && *r.output_size == 1048576);
+    assert (r.compiler && *r.compiler == "gcc 13.2.0");
+    assert (r.jobs && *r.jobs == 8);
+  }
+
+  // Absent and malformed values are not recorded.
+  //
+  {
+    build_metrics r (build_metrics::from_message (
+      "snapshot\n"
+      "\n"
+      "Build-Target: exe{x}\n"
+      "Build-State: unchanged\n"
+      "Build-Update-Time: soon\n"
+      "Snapshot-Skipped: core (excluded)"));
+
+    assert (r.target == "exe{x}");
+    assert (!r.changed);
+    assert (!r.update_time);
+    assert (!r.output_size);
+    assert (!r.compiler);
+  }
+
+  // Regressions between consecutive snapshots.
+  //
+  {
+    vector<git_snapshot_record> ss {
+      record ("i/1", 1, true,  1000, 500),
+      record ("i/2", 2, true,  1050, 500),  // Within the threshold.
+      record ("i/3", 3, false, 0,    500),  // No-op build in between.
+      record ("i/4", 4, true,  1500, 500),  // Update time regression.
+      record ("i/5", 5, true,  1500, 900)}; // Output size regression.
+
+    vector<git_snapshot_regression> rs (
+      git_snapshot_history::find_regressions (ss, 0.1));
+
+    assert (rs.size () == 2);
+
+    assert (rs[0].metric == "update time");
+    assert (rs[0].previous_ref == "i/2" && rs[0].current_ref == "i/4");
+    assert (rs[0].previous_value == 1050 && rs[0].current_value == 1500);
+
+    assert (rs[1].metric == "output size");
+    assert (rs[1].previous_ref == "i/4" && rs[1].current_ref == "i/5");
+  }
+
+  // Update times are only compared between builds with the same compiler
+  // and number of jobs, and small increases are treated as noise.
+  //
+  {
+    vector<git_snapshot_record> ss {
+      record ("i/1", 1, true, 1000, nullopt),
+      record ("i/2", 2, true, 3000, nullopt, "gcc 13.2.0", 1),
+      record ("i/3", 3, true, 2000, nullopt, "clang 17.0.0"),
+      record ("i/4", 4, true, 1090, nullopt),
+      record ("i/5", 5, true, 1180, nullopt)};
+
+    vector<git_snapshot_regression> rs (
+      git_snapshot_history::find_regressions (ss, 0.05, 100));
+
+    assert (rs.empty ());
+
+    rs = git_snapshot_history::find_regressions (ss, 0.05, 50);
+
+    assert (rs.size () == 2);
+    assert (rs[0].previous_ref == "i/1" && rs[0].current_ref == "i/4");
+    assert (rs[1].previous_ref == "i/4" && rs[1].current_ref == "i/5");
+  }
+}
@@ -0,0 +1,118 @@
+#include <stdexcept>
+
+#include <libbuild2/snapshot/matcher.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace build2::snapshot;
+
+static bool
+invalid (const char* p)
+{
+  try
+  {
+    path_matcher m ({p});
+    return false;
+  }
+  catch (const invalid_argument&)
+  {
+    return true;
+  }
+}
+
+int
+main ()
+{
+  // Empty matcher.
+  //
+  assert (!path_matcher ().match ("a"));
+  assert (!path_matcher ({"", "/", "//"}).match ("a"));
+
+  // Literal names match a component at any level, including directories.
+  //
+  {
+    path_matcher m ({"core"});
+
+    assert (m.match ("core"));
+    assert (m.match ("a/core"));
+    assert (m.match ("core/x"));
+    assert (!m.match ("cores"));
+    assert (!m.match ("a/xcore"));
+  }
+
+  // Suffix patterns.
+  //
+  {
+    path_matcher m ({"*.o"});
+
+    assert (m.match ("b.o"));
+    assert (m.match ("a/b.o"));
+    assert (m.match (".o"));
+    assert (!m.match ("a/b.oo"));
+    assert (!m.match ("a/bo"));
+  }
+
+  // Anchored patterns only match from the repository root.
+  //
+  {
+    path_matcher m ({"/build", "/top*"});
+
+    assert (m.match ("build"));
+    assert (m.match ("build/x"));
+    assert (!m.match ("a/build"));
+    assert (m.match ("topx/f"));
+    assert (!m.match ("a/topx"));
+  }
+
+  // Patterns with a slash are implicitly anchored.
+  //
+  {
+    path_matcher m ({"data/big", "out/*/obj"});
+
+    assert (m.match ("data/big"));
+    assert (m.match ("data/big/1"));
+    assert (!m.match ("data/bigger"));
+    assert (!m.match ("x/data/big"));
+    assert (m.match ("out/a/obj/f"));
+    assert (!m.match ("out/a/b/obj"));
+  }
+
+  // Double star crosses directory boundaries, single star and question mark
+  // don't.
+  //
+  {
+    path_matcher m ({"**/tmp*", "x?.log", "a/**/z"});
+
+    assert (m.match ("tmpx"));
+    assert (m.match ("a/b/tmp1/f"));
+    assert (m.match ("xy.log"));
+    assert (!m.match ("xyz.log"));
+    assert (m.match ("a/z"));
+    assert (m.match ("a/b/c/z"));
+    assert (!m.match ("b/z"));
+  }
+
+  // Trailing slash restricts the pattern to directories.
+  //
+  {
+    path_matcher m ({"cache/", "*.d/", "/out/"});
+
+    assert (m.match ("cache/f"));
+    assert (m.match ("a/cache/f"));
+    assert (!m.match ("cache"));
+    assert (!m.match ("a/cache"));
+    assert (m.match ("x.d/f"));
+    assert (!m.match ("x.d"));
+    assert (m.match ("out/f"));
+    assert (!m.match ("out"));
+  }
+
+  // Unsupported syntax is diagnosed.
+  //
+  assert (invalid ("!keep.log"));
+  assert (invalid ("*.[oa]"));
+  assert (invalid ("\\#x"));
+  assert (!invalid ("keep!.log"));
+}
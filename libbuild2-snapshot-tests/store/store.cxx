@@ -0,0 +1,142 @@
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+#include <libbuild2/diagnostics.hxx>
+
+#include <libbutl/fdstream.hxx>
+#include <libbutl/filesystem.hxx>
+
+#include <libbuild2/snapshot/git.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace butl;
+using namespace build2;
+using namespace build2::snapshot;
+
+static void
+write_file (const path& f, const string& s)
+{
+  ofdstream os (f);
+  os << s;
+  os.close ();
+}
+
+int
+main ()
+{
+  init_diag (1);
+
+  const string prefix ("refs/build2/snapshot");
+
+  // Run in a scratch repository with the store outside of it.
+  //
+  dir_path wd (dir_path::current_directory ());
+  dir_path d (dir_path::temp_path ("build2-snapshot-store"));
+  dir_path sd (dir_path::temp_path ("build2-snapshot-store-objects"));
+
+  try_mkdir_p (d);
+  try_mkdir_p (sd);
+  auto_rmdir rm (d);
+  auto_rmdir srm (sd);
+
+  dir_path::current_directory (d);
+
+  {
+    git_command_executor git;
+    git_repository_state state (git);
+
+    git.execute ({"init", "-q"});
+    git.execute ({"config", "user.name", "test"});
+    git.execute ({"config", "user.email", "test@example.org"});
+
+    write_file (path ("tracked"), "0\n");
+    git.execute ({"add", "tracked"});
+    git.execute ({"commit", "-q", "-m", "initial"});
+
+    // Snapshot staged changes so that each snapshot has objects that are
+    // only reachable from it.
+    //
+    git_snapshot_manager m (git);
+
+    for (size_t i (1); i != 4; ++i)
+    {
+      write_file (path ("tracked"), to_string (i) + '\n');
+      git.execute ({"add", "tracked"});
+
+      m.create_snapshot (git_snapshot_manager::snapshot_config ());
+    }
+
+    vector<git_reference_info> refs (state.list_references (prefix + '/'));
+    assert (refs.size () > 2);
+
+    // Store creation links it to the working repository objects.
+    //
+    git_snapshot_store store (git, sd / dir_path ("snapshot.git"));
+    store.initialize ();
+
+    assert (file_exists (store.directory () / path ("HEAD")));
+
+    {
+      ifdstream is (store.directory () / dir_path ("objects/info") /
+                    path ("alternates"));
+      string l;
+      getline (is, l);
+      is.close ();
+
+      dir_path objects (state.common_directory () / dir_path ("objects"));
+      assert (l == objects.string ());
+    }
+
+    // Migrate in several batches.
+    //
+    assert (store.migrate (prefix, 2) == refs.size ());
+
+    assert (state.list_references (prefix + '/').empty ());
+
+    git_command_executor sgit (store.reference_environment ());
+    git_repository_state sstate (sgit);
+
+    {
+      vector<git_reference_info> srefs (sstate.list_references (prefix + '/'));
+      assert (srefs.size () == refs.size ());
+
+      for (size_t i (0); i != refs.size (); ++i)
+      {
+        assert (srefs[i].name == refs[i].name);
+        assert (srefs[i].hash == refs[i].hash);
+      }
+    }
+
+    // Nothing left to migrate.
+    //
+    assert (store.migrate (prefix, 2) == 0);
+
+    // The snapshot objects survive the working repository pruning
+    // everything that is no longer reachable from its own references.
+    //
+    git.execute ({"reset", "-q", "--hard"});
+    git.execute ({"reflog", "expire", "--expire=now", "--all"});
+    git.execute ({"gc", "-q", "--prune=now"});
+
+    assert (sgit.try_execute ({"fsck", "--no-progress"}));
+
+    // New snapshots go straight into the store.
+    //
+    {
+      write_file (path ("tracked"), "4\n");
+      git.execute ({"add", "tracked"});
+
+      git_snapshot_manager::snapshot_config c;
+      c.store = store.directory ();
+
+      git_repository ().snapshot (c);
+
+      assert (state.list_references (prefix + '/').empty ());
+      assert (sstate.list_references (prefix + '/').size () > refs.size ());
+    }
+  }
+
+  dir_path::current_directory (wd);
+}
@@ -0,0 +1,142 @@
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+#include <libbuild2/diagnostics.hxx>
+
+#include <libbutl/fdstream.hxx>
+#include <libbutl/filesystem.hxx>
+
+#include <libbuild2/snapshot/git.hxx>
+
+#undef NDEBUG
+#include <cassert>
+
+using namespace std;
+using namespace butl;
+using namespace build2;
+using namespace build2::snapshot;
+
+static void
+write_file (const path& f, size_t size)
+{
+  ofdstream os (f);
+  os << string (size, 'x');
+  os.close ();
+}
+
+static bool
+contains (const string& s, const string& x)
+{
+  return s.find (x) != string::npos;
+}
+
+// Return the message of the most recent snapshot in the namespace.
+//
+static string
+last_snapshot (const git_command_executor& git, const string& ns)
+{
+  string r (git.execute ({"for-each-ref", "--sort=-refname", "--count=1",
+                          "--format=%(refname)",
+                          "refs/build2/snapshot/" + ns + '/'}));
+  assert (!r.empty ());
+  return r;
+}
+
+int
+main ()
+{
+  init_diag (1);
+
+  // Run in a scratch repository.
+  //
+  dir_path wd (dir_path::current_directory ());
+  dir_path d (dir_path::temp_path ("build2-snapshot-untracked"));
+
+  try_mkdir_p (d);
+  auto_rmdir rm (d);
+
+  dir_path::current_directory (d);
+
+  {
+    git_command_executor git;
+
+    git.execute ({"init", "-q"});
+    git.execute ({"config", "user.name", "test"});
+    git.execute ({"config", "user.email", "test@example.org"});
+
+    write_file (path ("tracked"), 1);
+    git.execute ({"add", "tracked"});
+    git.execute ({"commit", "-q", "-m", "initial"});
+
+    // Listed (and thus selected) in this order.
+    //
+    write_file (path ("big.bin"), 2000); // Over the per-file limit.
+    write_file (path ("mid1"), 600);     // Included.
+    write_file (path ("mid2"), 600);     // Over the total limit.
+    write_file (path ("skip.log"), 10);  // Excluded.
+    write_file (path ("small"), 10);     // Included.
+
+    git.execute ({"init", "-q", "sub"}); // Nested repository.
+    write_file (path ("sub/file"), 10);
+
+    git_snapshot_manager m (git);
+
+    // Size caps and exclusions with a working tree snapshot to record the
+    // skipped files in.
+    //
+    {
+      git_snapshot_manager::snapshot_config c;
+      c.untracked_max_file_size = 1000;
+      c.untracked_max_total_size = 1000;
+      c.untracked_exclude = path_matcher ({"*.log"});
+
+      m.create_snapshot (c);
+
+      string ref (last_snapshot (git, "wtree"));
+      string msg (git.execute ({"log", "-1", "--format=%B", ref}));
+
+      assert (contains (msg,
+        "Snapshot-Skipped: big.bin (2000 bytes exceeds per-file limit)"));
+      assert (contains (msg,
+        "Snapshot-Skipped: mid2 (600 bytes exceeds total limit)"));
+      assert (contains (msg, "Snapshot-Skipped: skip.log (excluded)"));
+      assert (contains (msg, "Snapshot-Skipped: sub/ (nested repository)"));
+      assert (!contains (msg, "Snapshot-Skipped: mid1"));
+      assert (!contains (msg, "Snapshot-Skipped: small"));
+
+      // The untracked files commit is the third parent.
+      //
+      string files (git.execute ({"ls-tree", "-r", "--name-only",
+                                  ref + "^3"}));
+      assert (files == "mid1\nsmall");
+    }
+
+    // With every untracked file skipped and no tracked changes there is no
+    // working tree snapshot so the skipped files are recorded in the index
+    // snapshot.
+    //
+    {
+      git_snapshot_manager::snapshot_config c;
+      c.untracked_max_file_size = 1;
+
+      string wtree (last_snapshot (git, "wtree"));
+
+      m.create_snapshot (c);
+
+      assert (last_snapshot (git, "wtree") == wtree);
+
+      string ref (last_snapshot (git, "index"));
+      string msg (git.execute ({"log", "-1", "--format=%B", ref}));
+
+      assert (contains (msg,
+        "Snapshot-Skipped: small (10 bytes exceeds per-file limit)"));
+    }
+
+    // The user's index and working tree are left alone.
+    //
+    assert (git.execute ({"status", "--porcelain", "--untracked-files=no"})
+            .empty ());
+    assert (git.execute ({"stash", "list"}).empty ());
+  }
+
+  dir_path::current_directory (wd);
+}
@@ -5,6 +5,9 @@
 #include <libbutl/process.hxx>
 #include <libbutl/timestamp.hxx>
 #include <libbutl/fdstream.hxx>
+#include <libbutl/filesystem.hxx>
+
+#include <atomic>
 
 using namespace std;
 using namespace butl;
@@ -24,6 +27,88 @@ namespace build2
       return s.substr (start, end - start + 1);
     }
 
+    // Append trailers to the commit message as its last paragraph.
+    //
+    static void
+    append_trailers (string& message, const strings& trailers)
+    {
+      if (trailers.empty ())
+        return;
+
+      message += '\n';
+      for (const string& t: trailers)
+      {
+        message += '\n';
+        message += t;
+      }
+    }
+
+    // Record the untracked files that were left out as trailers so that it's
+    // clear from the snapshot itself what it is missing. Cap their number
+    // since an unignored output directory can easily contain thousands of
+    // files.
+    //
+    static strings
+    skipped_trailers (const vector<git_skipped_entry>& skipped)
+    {
+      const size_t max_trailers (100);
+
+      strings r;
+
+      size_t n (0);
+      for (const git_skipped_entry& e: skipped)
+      {
+        if (n++ == max_trailers)
+          break;
+
+        r.push_back ("Snapshot-Skipped: " + e.path + " (" + e.reason + ")");
+      }
+
+      if (skipped.size () > max_trailers)
+        r.push_back ("Snapshot-Skipped: ... (" +
+                     to_string (skipped.size () - max_trailers) + " more)");
+
+      return r;
+    }
+
+    // Return a temporary file path in the specified directory unique to this
+    // call. The process id keeps separate builds apart and the counter keeps
+    // apart the snapshots that the same build creates concurrently for
+    // several targets.
+    //
+    static path
+    temp_file (const dir_path& d, const char* ext)
+    {
+      static std::atomic<size_t> counter (0);
+
+      return d / path ("build2-snapshot-" +
+                       to_string (process::current_id ()) + '-' +
+                       to_string (counter.fetch_add (1)) + ext);
+    }
+
+    // Write the standard input for a git command to a file.
+    //
+    static void
+    write_input (const path& f, const string& data)
+    {
+      try
+      {
+        ofdstream os (f);
+        os << data;
+        os.close ();
+      }
+      catch (const io_error& e)
+      {
+        fail << "unable to write " << f << ": " << e;
+      }
+    }
+
+    // Serializes the snapshots that the same build creates for several
+    // targets concurrently since they share the store, its migration, and
+    // the reference names.
+    //
+    static mutex snapshot_mutex;
+
     // git_command_executor
     //
 
@@ -62,6 +147,29 @@ namespace build2
 
     optional<string> git_command_executor::
     execute_optional (const strings& args) const noexcept
+    {
+      return execute_optional (args, strings ());
+    }
+
+    string git_command_executor::
+    execute (const strings& args, const strings& env, const path& input) const
+    {
+      tracer trace ("git_command_executor::execute");
+
+      l5 ([&] { trace << "executing: " << format_command (args); });
+
+      optional<string> result = execute_optional (args, env, input);
+
+      if (!result)
+        throw git_command_error (format_command (args), "command failed");
+
+      return std::move (*result);
+    }
+
+    optional<string> git_command_executor::
+    execute_optional (const strings& args,
+                      const strings& env,
+                      const path& input) const noexcept
     {
       tracer trace ("git_command_executor::execute_optional");
 
@@ -76,11 +184,30 @@ namespace build2
           cmd_args.push_back (arg.c_str ());
         cmd_args.push_back (nullptr);
 
+        cstrings env_vars;
+        for (const string& var : env_)
+          env_vars.push_back (var.c_str ());
+        for (const string& var : env)
+          env_vars.push_back (var.c_str ());
+        env_vars.push_back (nullptr);
+
+        auto_fd in_fd;
+        int in (0);
+        if (!input.empty ())
+        {
+          in_fd = fdopen (input, fdopen_mode::in);
+          in = in_fd.get ();
+        }
+
         process pr (pp,
                     cmd_args,
-                    0 /* stdin */,
+                    in /* stdin */,
                    -1 /* stdout */,
-                    2 /* stderr */);
+                    2 /* stderr */,
+                    nullptr /* cwd */,
+                    env_vars.size () == 1 ? nullptr : env_vars.data ());
+
+        in_fd.reset ();
 
         string output;
         ifdstream is (std::move (pr.in_ofd),
@@ -113,6 +240,11 @@ namespace build2
         l5 ([&] { trace << "process error: " << e.what (); });
         return nullopt;
       }
+      catch (const io_error& e)
+      {
+        l5 ([&] { trace << "io error: " << e.what (); });
+        return nullopt;
+      }
     }
 
     string git_command_executor::
@@ -209,6 +341,64 @@ namespace build2
       return !has_uncommitted_changes ();
     }
 
+    strings git_repository_state::
+    list_untracked_files () const
+    {
+      tracer trace ("git_repository_state::list_untracked_files");
+
+      // The top-level magic pathspec lists the files from the whole repository
+      // regardless of the current working directory and NUL separation gives
+      // us the paths verbatim (no quoting). Note that we fail rather than
+      // return an empty list if the command fails since otherwise the
+      // untracked files would be silently left out of the snapshot.
+      //
+      string output (executor_.execute (
+        {"ls-files", "--others", "--exclude-standard", "--full-name", "-z",
+         "--", ":/"}));
+
+      strings files;
+      for (size_t b (0), e; b < output.size (); b = e + 1)
+      {
+        e = output.find ('\0', b);
+        if (e == string::npos)
+          e = output.size ();
+
+        if (e != b)
+          files.push_back (string (output, b, e - b));
+      }
+
+      l5 ([&] { trace << "found " << files.size () << " untracked files"; });
+      return files;
+    }
+
+    dir_path git_repository_state::
+    root_directory () const
+    {
+      return dir_path (
+        trim (executor_.execute ({"rev-parse", "--show-toplevel"})));
+    }
+
+    dir_path git_repository_state::
+    git_directory () const
+    {
+      return dir_path (
+        trim (executor_.execute ({"rev-parse", "--absolute-git-dir"})));
+    }
+
+    dir_path git_repository_state::
+    common_directory () const
+    {
+      // Note that --git-common-dir may be relative to the current directory.
+      //
+      dir_path d (trim (executor_.execute ({"rev-parse", "--git-common-dir"})));
+
+      if (d.relative ())
+        d = dir_path::current_directory () / d;
+
+      d.normalize ();
+      return d;
+    }
+
     optional<string> git_repository_state::
     current_branch () const
     {
@@ -295,6 +485,31 @@ namespace build2
       l5 ([&] { trace << "reference updated successfully"; });
     }
 
+    string git_reference_manager::
+    create_unique_reference (const string& ref_name,
+                             const string& commit_hash) const
+    {
+      tracer trace ("git_reference_manager::create_unique_reference");
+
+      for (size_t i (0);; ++i)
+      {
+        string n (i == 0 ? ref_name : ref_name + '-' + to_string (i));
+
+        // The empty old value makes git fail rather than overwrite an
+        // existing reference.
+        //
+        if (executor_.try_execute ({"update-ref", n, commit_hash, ""}))
+        {
+          l5 ([&] { trace << "created ref: " << n << " -> " << commit_hash; });
+          return n;
+        }
+
+        if (!reference_exists (n))
+          throw git_command_error ("git update-ref " + n + ' ' + commit_hash,
+                                   "unable to create reference");
+      }
+    }
+
     void git_reference_manager::
     delete_reference (const string& ref_name) const
     {
@@ -348,6 +563,196 @@ namespace build2
       return base_path + "/" + branch_name + "/" + timestamp;
     }
 
+    // git_snapshot_store
+    //
+
+    void git_snapshot_store::
+    initialize () const
+    {
+      tracer trace ("git_snapshot_store::initialize");
+
+      if (!file_exists (directory_ / path ("HEAD")))
+      {
+        l4 ([&] { trace << "creating snapshot store " << directory_; });
+
+        executor_.execute ({"init", "--bare", "-q", directory_.string ()});
+
+        // The store may well end up inside the working tree (for example,
+        // with an in-source build) so make sure it's ignored there rather
+        // than reported and captured as untracked files.
+        //
+        path ignore (directory_ / path (".gitignore"));
+
+        try
+        {
+          ofdstream os (ignore);
+          os << "*\n";
+          os.close ();
+        }
+        catch (const io_error& e)
+        {
+          fail << "unable to write " << ignore << ": " << e;
+        }
+      }
+
+      // Point the store to the working repository objects. Note that we
+      // rewrite the file if it doesn't match in case the working repository
+      // has been moved.
+      //
+      path alternates (directory_ / dir_path ("objects/info") /
+                       path ("alternates"));
+
+      string objects (
+        (git_repository_state (executor_).common_directory () /
+         dir_path ("objects")).string ());
+
+      try
+      {
+        if (file_exists (alternates))
+        {
+          ifdstream is (alternates);
+          string line;
+          getline (is, line);
+          is.close ();
+
+          if (line == objects)
+            return;
+        }
+
+        try_mkdir_p (alternates.directory ());
+
+        ofdstream os (alternates);
+        os << objects << '\n';
+        os.close ();
+      }
+      catch (const io_error& e)
+      {
+        fail << "unable to write " << alternates << ": " << e;
+      }
+      catch (const system_error& e)
+      {
+        fail << "unable to create " << alternates.directory () << ": " << e;
+      }
+
+      l5 ([&] { trace << "linked " << directory_ << " to " << objects; });
+    }
+
+    size_t git_snapshot_store::
+    migrate (const string& ref_prefix, size_t batch_size) const
+    {
+      tracer trace ("git_snapshot_store::migrate");
+
+      // Note that executor_ operates on the working repository.
+      //
+      git_repository_state state (executor_);
+
+      vector<git_reference_info> refs (
+        state.list_references (ref_prefix + "/"));
+
+      if (refs.empty ())
+        return 0;
+
+      l4 ([&] { trace << "migrating " << refs.size () << " snapshots to "
+                      << directory_; });
+
+      // The rest of the references whose objects the working repository
+      // keeps anyway and which therefore don't need to be copied.
+      //
+      strings exclude_refs;
+      for (git_reference_info& r: state.list_references ())
+      {
+        if (r.name.compare (0, ref_prefix.size () + 1, ref_prefix + "/") != 0)
+          exclude_refs.push_back (std::move (r.name));
+      }
+
+      for (size_t i (0); i < refs.size (); i += batch_size)
+      {
+        vector<git_reference_info> batch (
+          refs.begin () + i,
+          refs.begin () + std::min (i + batch_size, refs.size ()));
+
+        migrate_batch (batch, exclude_refs);
+      }
+
+      return refs.size ();
+    }
+
+    void git_snapshot_store::
+    migrate_batch (const vector<git_reference_info>& refs,
+                   const strings& exclude_refs) const
+    {
+      tracer trace ("git_snapshot_store::migrate_batch");
+
+      dir_path git_dir (git_repository_state (executor_).git_directory ());
+      path input (temp_file (git_dir, ".input"));
+      auto_rmfile input_rm (input);
+
+      // Copy the objects that are only reachable from the snapshots into a
+      // pack in the store. Everything else stays reachable in the working
+      // repository and is borrowed through the alternates.
+      //
+      {
+        string revs;
+        for (const git_reference_info& r: refs)
+          revs += r.hash + '\n';
+
+        revs += "--not\n";
+        for (const string& r: exclude_refs)
+          revs += r + '\n';
+
+        write_input (input, revs);
+
+        executor_.execute (
+          {"pack-objects", "--revs", "-q",
+           (directory_ / dir_path ("objects/pack") / path ("pack")).string ()},
+          strings (),
+          input);
+      }
+
+      // Create the references in the store and only then remove them from
+      // the working repository, each in a single transaction. Fail rather
+      // than overwrite if a reference already exists in the store and verify
+      // the old values on removal in case they have changed in the meantime.
+      //
+      {
+        string cmds;
+        for (const git_reference_info& r: refs)
+          cmds += "create " + r.name + ' ' + r.hash + '\n';
+
+        write_input (input, cmds);
+
+        executor_.execute ({"update-ref", "--stdin"},
+                           reference_environment (),
+                           input);
+      }
+
+      {
+        string cmds;
+        for (const git_reference_info& r: refs)
+          cmds += "delete " + r.name + ' ' + r.hash + '\n';
+
+        write_input (input, cmds);
+
+        executor_.execute ({"update-ref", "--stdin"}, strings (), input);
+      }
+
+      l5 ([&] { trace << "migrated " << refs.size () << " references"; });
+    }
+
+    strings git_snapshot_store::
+    object_environment () const
+    {
+      return strings {
+        "GIT_OBJECT_DIRECTORY=" +
+        (directory_ / dir_path ("objects")).string ()};
+    }
+
+    strings git_snapshot_store::
+    reference_environment () const
+    {
+      return strings {"GIT_DIR=" + directory_.string ()};
+    }
+
     // git_snapshot_manager
     //
 
@@ -361,16 +766,17 @@ namespace build2
 
       validate_snapshot_preconditions ();
 
-      string index_ref = create_index_snapshot (config);
-
-      l5 ([&] { trace << "index snapshot created: " << index_ref; });
+      git_untracked_selection untracked;
+      if (config.include_working_tree && config.include_untracked)
+        untracked = select_untracked_files (config);
 
       // Create working tree snapshot if needed (i.e. if there are uncommitted
       // changes)
       //
+      optional<string> wtree_ref;
       if (config.include_working_tree)
       {
-        optional<string> wtree_ref = create_working_tree_snapshot (config);
+        wtree_ref = create_working_tree_snapshot (config, untracked);
         if (wtree_ref)
         {
           l5 ([&] { trace << "working tree snapshot created: "
@@ -382,6 +788,15 @@ namespace build2
         }
       }
 
+      // If there is no working tree snapshot to record the skipped untracked
+      // files in, then record them in the index snapshot instead.
+      //
+      string index_ref = create_index_snapshot (
+        config,
+        !wtree_ref ? untracked.skipped : vector<git_skipped_entry> ());
+
+      l5 ([&] { trace << "index snapshot created: " << index_ref; });
+
       l1 ([&] { trace << "snapshot created successfully"; });
     }
 
@@ -393,7 +808,8 @@ namespace build2
     }
 
     string git_snapshot_manager::
-    create_index_snapshot (const snapshot_config& config) const
+    create_index_snapshot (const snapshot_config& config,
+                           const vector<git_skipped_entry>& skipped) const
     {
       tracer trace ("git_snapshot_manager::create_index_snapshot");
 
@@ -402,7 +818,12 @@ namespace build2
         fail << "cannot create snapshot without HEAD commit";
 
       string tree_hash = trim (executor_.execute ({"write-tree"}));
+      strings trailers (config.trailers);
+      for (string& t: skipped_trailers (skipped))
+        trailers.push_back (std::move (t));
+
       string message = generate_snapshot_message (config);
+      append_trailers (message, trailers);
       string commit_hash = create_commit_tree (tree_hash, head->hash, message);
 
       l5 ([&] { trace << "tree hash: " << tree_hash; });
@@ -433,39 +854,84 @@ namespace build2
           refs_.generate_timestamped_ref (config.ref_prefix + "/index");
       }
 
-      // fast-forwards the ref <ref_name> to <commit_hash>
+      // Create the ref <ref_name> pointing to <commit_hash>, making it unique
+      // if several targets are snapshotted in the same second.
       //
-      refs_.update_reference (ref_name, commit_hash);
-
-      return ref_name;
+      return refs_.create_unique_reference (ref_name, commit_hash);
     }
 
     optional<string> git_snapshot_manager::
-    create_working_tree_snapshot (const snapshot_config& config) const
+    create_working_tree_snapshot (
+      const snapshot_config& config,
+      const git_untracked_selection& untracked) const
     {
       tracer trace ("git_snapshot_manager::create_working_tree_snapshot");
 
-      if (state_.is_clean_working_tree () &&
-          (!config.include_untracked || !state_.has_untracked_files ()))
+      // The timestamp is in the format: YYYYMMDD-HHMMSS (UTC).
+      //
+      string timestamp = to_string (timestamp::clock::now (),
+                                   "%Y%m%d-%H%M%S", true, true);
+      string stash_message = "snapshot " + timestamp;
+
+      // Capture the tracked changes as a stash commit without touching the
+      // working tree or the stash stack. The output is empty if there are no
+      // such changes.
+      //
+      string stash_hash =
+        trim (executor_.execute ({"stash", "create", stash_message}));
+
+      if (stash_hash.empty () && untracked.included.empty ())
       {
         l5 ([&] { trace << "working tree is clean, no snapshot needed"; });
         return nullopt;
       }
 
-      // The timestamp is in the format: YYYYMMDD-HHMMSS (UTC).
+      // Assemble the snapshot commit in the same layout as `git stash` uses
+      // so that it can be inspected and applied with the stash commands:
+      // HEAD as the first parent, the index commit as the second, and the
+      // untracked files commit (if any) as the third.
       //
-      string timestamp = to_string (timestamp::clock::now (),
-                                   "%Y%m%d-%H%M%S", true, true);
-      string stash_message = "snapshot " + timestamp;
+      string head_hash = trim (executor_.execute ({"rev-parse", "HEAD"}));
+      string tree_hash;
+      string index_hash;
+
+      if (!stash_hash.empty ())
+      {
+        l5 ([&] { trace << "stash hash: " << stash_hash; });
+
+        tree_hash = trim (executor_.execute (
+          {"rev-parse", stash_hash + "^{tree}"}));
+        index_hash = trim (executor_.execute (
+          {"rev-parse", stash_hash + "^2"}));
+      }
+      else
+      {
+        tree_hash = trim (executor_.execute ({"write-tree"}));
+        index_hash = create_commit_tree (tree_hash,
+                                         head_hash,
+                                         "index on " + stash_message);
+      }
+
+      strings parents {head_hash, index_hash};
 
-      strings stash_args = {"stash", "push", "-m", stash_message};
-      if (config.include_untracked)
-        stash_args.insert (stash_args.begin () + 2, "--include-untracked");
+      if (!untracked.included.empty ())
+      {
+        l5 ([&] { trace << "capturing " << untracked.included.size ()
+                        << " untracked files, " << untracked.included_size
+                        << " bytes"; });
+
+        parents.push_back (
+          create_untracked_commit (untracked.included, stash_message));
+      }
 
-      executor_.execute (stash_args);
+      strings trailers (config.trailers);
+      for (string& t: skipped_trailers (untracked.skipped))
+        trailers.push_back (std::move (t));
 
-      string stash_hash = trim (executor_.execute ({"rev-parse", "stash@{0}"}));
-      l5 ([&] { trace << "stash hash: " << stash_hash; });
+      string message (stash_message);
+      append_trailers (message, trailers);
+
+      string commit_hash = create_commit_tree (tree_hash, parents, message);
 
       // Generate our own permanent, timestamped reference under the working
       // tree namespace.
@@ -475,41 +941,162 @@ namespace build2
       //
       string ref_name =
         refs_.generate_timestamped_ref (config.ref_prefix + "/wtree");
-      refs_.update_reference (ref_name, stash_hash);
 
-      // Restore the working tree state from the stash.
-      //
-      // After capturing the working tree state in a permanent reference, we
-      // restore the original working tree state so that we can continue working
-      // normally.
-      //
-      executor_.execute ({"stash", "apply", "stash@{0}"});
-      l5 ([&] { trace << "working tree restored from stash"; });
+      return refs_.create_unique_reference (ref_name, commit_hash);
+    }
 
-      // Remove the transient stash entry.
+    git_untracked_selection git_snapshot_manager::
+    select_untracked_files (const snapshot_config& config) const
+    {
+      tracer trace ("git_snapshot_manager::select_untracked_files");
+
+      git_untracked_selection r;
+
+      strings files (state_.list_untracked_files ());
+      if (files.empty ())
+        return r;
+
+      dir_path root (state_.root_directory ());
+
+      for (string& f: files)
+      {
+        if (config.untracked_exclude.match (f))
+        {
+          r.skipped.push_back ({std::move (f), "excluded"});
+          continue;
+        }
+
+        // A nested repository is listed as a directory (with the trailing
+        // slash) and update-index would silently ignore it.
+        //
+        if (f.back () == '/')
+        {
+          r.skipped.push_back ({std::move (f), "nested repository"});
+          continue;
+        }
+
+        // Don't follow symlinks since git stores the link itself.
+        //
+        pair<bool, entry_stat> pe (
+          path_entry (root / path (f),
+                      false /* follow_symlinks */,
+                      true  /* ignore_error */));
+
+        if (!pe.first)
+          continue; // Removed since listed.
+
+        if (pe.second.type != entry_type::regular &&
+            pe.second.type != entry_type::symlink)
+        {
+          r.skipped.push_back ({std::move (f), "not a regular file"});
+          continue;
+        }
+
+        uint64_t n (pe.second.size);
+
+        if (config.untracked_max_file_size != 0 &&
+            n > config.untracked_max_file_size)
+        {
+          r.skipped.push_back (
+            {std::move (f),
+             to_string (n) + " bytes exceeds per-file limit"});
+          continue;
+        }
+
+        if (config.untracked_max_total_size != 0 &&
+            r.included_size + n > config.untracked_max_total_size)
+        {
+          r.skipped.push_back (
+            {std::move (f),
+             to_string (n) + " bytes exceeds total limit"});
+          continue;
+        }
+
+        r.included_size += n;
+        r.included.push_back (std::move (f));
+      }
+
+      l5 ([&] { trace << "selected " << r.included.size () << ", skipped "
+                      << r.skipped.size () << " untracked files"; });
+
+      return r;
+    }
+
+    string git_snapshot_manager::
+    create_untracked_commit (const strings& paths, const string& message) const
+    {
+      tracer trace ("git_snapshot_manager::create_untracked_commit");
+
+      // Stage the files into a temporary index so that the user's index is
+      // left alone.
       //
-      // After promoting the stash to a permanent reference, we drop the
-      // original stash entry (`stash@{0}`) to avoid duplication and maintain a
-      // clean stash stack. This operation is non-fatal; if it fails (e.g., due
-      // to race conditions or prior deletion), we proceed regardless.
+      dir_path git_dir (state_.git_directory ());
+
+      path index_file (temp_file (git_dir, ".index"));
+      path list_file (temp_file (git_dir, ".list"));
+
+      try_rmfile (index_file, true /* ignore_error */);
+
+      auto_rmfile index_rm (index_file);
+      auto_rmfile list_rm (list_file);
+
+      try
+      {
+        ofdstream os (list_file);
+        for (const string& p: paths)
+          os.write (p.c_str (), p.size () + 1); // Including '\0'.
+        os.close ();
+      }
+      catch (const io_error& e)
+      {
+        fail << "unable to write " << list_file << ": " << e;
+      }
+
+      strings env {"GIT_INDEX_FILE=" + index_file.string ()};
+
+      // Lower the big file threshold so that git streams the larger blobs
+      // into a pack rather than reading them into memory for hashing.
       //
-      optional<string> stash_drop =
-        executor_.execute_optional ({"stash", "drop", "stash@{0}"});
-      if (!stash_drop || stash_drop->empty())
-        l5 ([&] { trace << "failed to drop stash, continuing with snapshot"; });
+      executor_.execute ({"-C", state_.root_directory ().string (),
+                          "-c", "core.bigFileThreshold=1m",
+                          "update-index", "--add", "-z", "--stdin"},
+                         env,
+                         list_file);
+
+      string tree_hash = trim (executor_.execute ({"write-tree"}, env));
+
+      l5 ([&] { trace << "untracked tree hash: " << tree_hash; });
 
-      return ref_name;
+      return create_commit_tree (tree_hash,
+                                 strings (),
+                                 "untracked files on " + message);
     }
 
     string git_snapshot_manager::
     create_commit_tree (const string& tree_hash,
                        const string& parent_hash,
                        const string& message) const
+    {
+      return create_commit_tree (tree_hash, strings {parent_hash}, message);
+    }
+
+    string git_snapshot_manager::
+    create_commit_tree (const string& tree_hash,
+                       const strings& parent_hashes,
+                       const string& message) const
     {
       tracer trace ("git_snapshot_manager::create_commit_tree");
 
-      string commit_hash = trim (executor_.execute (
-        {"commit-tree", tree_hash, "-p", parent_hash, "-m", message}));
+      strings args {"commit-tree", tree_hash};
+      for (const string& p: parent_hashes)
+      {
+        args.push_back ("-p");
+        args.push_back (p);
+      }
+      args.push_back ("-m");
+      args.push_back (message);
+
+      string commit_hash = trim (executor_.execute (args));
 
       l5 ([&] { trace << "created commit: " << commit_hash; });
       return commit_hash;
@@ -518,12 +1105,16 @@ namespace build2
     string git_snapshot_manager::
     generate_snapshot_message (const snapshot_config& config) const
     {
-      if (!config.message.empty ())
-        return config.message;
+      string message (config.message);
 
-      string timestamp = to_string (timestamp::clock::now (),
-                                   "%Y%m%d-%H%M%S", true, true);
-      return "build2 snapshot " + timestamp;
+      if (message.empty ())
+      {
+        string timestamp = to_string (timestamp::clock::now (),
+                                     "%Y%m%d-%H%M%S", true, true);
+        message = "build2 snapshot " + timestamp;
+      }
+
+      return message;
     }
 
     void git_snapshot_manager::
@@ -553,6 +1144,43 @@ namespace build2
       snapshot_manager_.create_snapshot (config);
     }
 
+    void git_repository::
+    snapshot (const git_snapshot_manager::snapshot_config& config) const
+    {
+      tracer trace ("git_repository::snapshot");
+
+      mlock l (snapshot_mutex);
+
+      if (!config.store)
+      {
+        snapshot_manager_.create_snapshot (config);
+        return;
+      }
+
+      // Move any snapshots still in the working repository (for example,
+      // created before the store was configured) over to the store before
+      // adding new ones there.
+      //
+      // Note that we don't consolidate the packs that the migration batches
+      // add: a local repack (-l) would drop the migrated objects that the
+      // working repository still has copies of (until it prunes them) while
+      // a non-local one would copy in the whole history.
+      //
+      git_snapshot_store store (executor_, *config.store);
+      store.initialize ();
+
+      size_t n (store.migrate (config.ref_prefix));
+      if (n != 0)
+        l4 ([&] { trace << "migrated " << n << " snapshots to "
+                        << store.directory (); });
+
+      git_command_executor object_executor (store.object_environment ());
+      git_command_executor reference_executor (store.reference_environment ());
+
+      git_snapshot_manager (object_executor, reference_executor)
+        .create_snapshot (config);
+    }
+
     bool git_repository::
     is_clean () const
     {
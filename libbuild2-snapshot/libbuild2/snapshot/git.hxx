@@ -4,6 +4,7 @@
 #include <libbuild2/utility.hxx>
 
 #include <libbuild2/snapshot/export.hxx>
+#include <libbuild2/snapshot/matcher.hxx>
 
 namespace build2
 {
@@ -43,11 +44,31 @@ namespace build2
       bool is_branch;
     };
 
+    struct git_skipped_entry
+    {
+      string path;   // Relative to the repository root.
+      string reason;
+    };
+
+    struct git_untracked_selection
+    {
+      strings included; // Relative to the repository root.
+      uint64_t included_size = 0;
+      vector<git_skipped_entry> skipped;
+    };
+
     class LIBBUILD2_SNAPSHOT_SYMEXPORT git_command_executor
     {
     public:
       git_command_executor () = default;
 
+      // Run every command with the additional environment variables (in the
+      // NAME=VALUE form), for example, to point git to a different object
+      // database or repository.
+      //
+      explicit git_command_executor (strings env)
+        : env_ (std::move (env)) {}
+
       string
       execute (const strings& args) const;
 
@@ -57,11 +78,26 @@ namespace build2
       optional<string>
       execute_optional (const strings& args) const noexcept;
 
+      // Execute with additional environment variables (in the NAME=VALUE
+      // form) and, if specified, with stdin redirected from the input file.
+      //
+      string
+      execute (const strings& args,
+               const strings& env,
+               const path& input = path ()) const;
+
+      optional<string>
+      execute_optional (const strings& args,
+                        const strings& env,
+                        const path& input = path ()) const noexcept;
+
     private:
       // Build full command line for diagnostics.
       //
       string
       format_command (const strings& args) const;
+
+      strings env_;
     };
 
     class LIBBUILD2_SNAPSHOT_SYMEXPORT git_repository_state
@@ -94,6 +130,25 @@ namespace build2
       bool
       is_clean_working_tree () const;
 
+      // Return untracked files that are not ignored, relative to the
+      // repository root. Nested repositories are returned as directories
+      // (with the trailing slash).
+      //
+      strings
+      list_untracked_files () const;
+
+      dir_path
+      root_directory () const;
+
+      dir_path
+      git_directory () const;
+
+      // Return the absolute directory shared by all the worktrees (which is
+      // where the object database lives).
+      //
+      dir_path
+      common_directory () const;
+
       // Branch and reference queries
       //
 
@@ -124,6 +179,14 @@ namespace build2
       void
       update_reference (const string& ref_name, const string& commit_hash) const;
 
+      // Create a new reference to the commit, adding a numeric suffix to
+      // the name if it's already taken (for example, by a snapshot of
+      // another target created in the same second). Return the name used.
+      //
+      string
+      create_unique_reference (const string& ref_name,
+                               const string& commit_hash) const;
+
       void
       delete_reference (const string& ref_name) const;
 
@@ -145,6 +208,55 @@ namespace build2
       const git_command_executor& executor_;
     };
 
+    // Local bare repository that holds the snapshot objects and references
+    // in place of the working repository. It borrows the working repository
+    // objects through objects/info/alternates so that only the objects new
+    // to snapshots end up in it.
+    //
+    class LIBBUILD2_SNAPSHOT_SYMEXPORT git_snapshot_store
+    {
+    public:
+      git_snapshot_store (const git_command_executor& exec, dir_path dir)
+        : executor_ (exec),
+          directory_ (std::move (dir)) {}
+
+      // Create the store if it doesn't exist yet and link it to the working
+      // repository object database.
+      //
+      void
+      initialize () const;
+
+      // Move the snapshot references under the prefix from the working
+      // repository into the store, together with the objects that are only
+      // reachable from them, in batches. Return the number of references
+      // moved.
+      //
+      size_t
+      migrate (const string& ref_prefix, size_t batch_size = 1000) const;
+
+      // Environment for commands that operate on the working repository but
+      // should write new objects into the store.
+      //
+      strings
+      object_environment () const;
+
+      // Environment for commands that operate on the store itself.
+      //
+      strings
+      reference_environment () const;
+
+      const dir_path&
+      directory () const { return directory_; }
+
+    private:
+      const git_command_executor& executor_;
+      dir_path directory_;
+
+      void
+      migrate_batch (const vector<git_reference_info>& refs,
+                     const strings& exclude_refs) const;
+    };
+
     class LIBBUILD2_SNAPSHOT_SYMEXPORT git_snapshot_manager
     {
     public:
@@ -154,6 +266,25 @@ namespace build2
         bool include_working_tree = true;
         bool include_untracked = true;
         string ref_prefix = "refs/build2/snapshot";
+
+        // Additional metadata in the `Key: value` form recorded as trailers
+        // in the snapshot commit messages.
+        //
+        strings trailers = {};
+
+        // If specified, keep the snapshot objects and references in a
+        // separate bare repository at this location rather than in the
+        // working repository (see git_snapshot_store).
+        //
+        optional<dir_path> store = nullopt;
+
+        // Untracked files capture limits in bytes (0 means unlimited) and
+        // exclusions. Files that are left out are recorded in the working
+        // tree snapshot commit message.
+        //
+        uint64_t untracked_max_file_size = 10 * 1024 * 1024;
+        uint64_t untracked_max_total_size = 100 * 1024 * 1024;
+        path_matcher untracked_exclude = {};
       };
 
       explicit git_snapshot_manager (const git_command_executor& exec)
@@ -161,6 +292,15 @@ namespace build2
           state_ (exec),
           refs_ (exec) {}
 
+      // Use a separate executor for the reference operations, for example,
+      // one that operates on the snapshot store.
+      //
+      git_snapshot_manager (const git_command_executor& exec,
+                            const git_command_executor& ref_exec)
+        : executor_ (exec),
+          state_ (exec),
+          refs_ (ref_exec) {}
+
       // Create complete snapshot of repository state.
       //
 
@@ -187,11 +327,23 @@ namespace build2
       // Individual snapshot operations.
       //
 
+      // Record the skipped untracked files, if any, as trailers.
+      //
       string
-      create_index_snapshot (const snapshot_config& config) const;
+      create_index_snapshot (const snapshot_config& config,
+                             const vector<git_skipped_entry>& skipped) const;
 
       optional<string>
-      create_working_tree_snapshot (const snapshot_config& config) const;
+      create_working_tree_snapshot (
+        const snapshot_config& config,
+        const git_untracked_selection& untracked) const;
+
+      git_untracked_selection
+      select_untracked_files (const snapshot_config& config) const;
+
+      string
+      create_untracked_commit (const strings& paths,
+                               const string& message) const;
 
       // Helper functions.
       //
@@ -201,6 +353,11 @@ namespace build2
                          const string& parent_hash,
                          const string& message) const;
 
+      string
+      create_commit_tree (const string& tree_hash,
+                         const strings& parent_hashes,
+                         const string& message) const;
+
       string
       generate_snapshot_message (const snapshot_config& config) const;
 
@@ -216,6 +373,9 @@ namespace build2
       void
       snapshot (const string& message = {}) const;
 
+      void
+      snapshot (const git_snapshot_manager::snapshot_config& config) const;
+
       // Repository state queries.
       //
 
@@ -0,0 +1,269 @@
+#include <libbuild2/snapshot/history.hxx>
+
+#include <map>
+#include <cstring>   // strlen()
+#include <algorithm> // stable_sort()
+
+#include <libbuild2/diagnostics.hxx>
+
+using namespace std;
+
+namespace build2
+{
+  namespace snapshot
+  {
+    // Parse an unsigned integer value optionally followed by the specified
+    // unit suffix.
+    //
+    static optional<uint64_t>
+    parse_uint (string v, const char* unit = nullptr)
+    {
+      if (unit != nullptr)
+      {
+        size_t n (strlen (unit));
+        if (v.size () > n && v.compare (v.size () - n, n, unit) == 0)
+          v.resize (v.size () - n);
+      }
+
+      if (v.empty () || v.find_first_not_of ("0123456789") != string::npos)
+        return nullopt;
+
+      try
+      {
+        return static_cast<uint64_t> (stoull (v));
+      }
+      catch (const out_of_range&)
+      {
+        return nullopt;
+      }
+    }
+
+    // build_metrics
+    //
+
+    strings build_metrics::
+    to_trailers () const
+    {
+      strings r;
+
+      r.push_back ("Build-Target: " + target);
+      r.push_back (string ("Build-State: ") +
+                   (changed ? "changed" : "unchanged"));
+
+      if (wall_time)
+        r.push_back ("Build-Wall-Time: " + to_string (*wall_time) + "ms");
+
+      if (update_time)
+        r.push_back ("Build-Update-Time: " + to_string (*update_time) + "ms");
+
+      if (output_size)
+        r.push_back ("Build-Output-Size: " + to_string (*output_size));
+
+      if (compiler)
+        r.push_back ("Build-Compiler: " + *compiler);
+
+      if (jobs)
+        r.push_back ("Build-Jobs: " + to_string (*jobs));
+
+      return r;
+    }
+
+    build_metrics build_metrics::
+    from_message (const string& message)
+    {
+      build_metrics r;
+
+      istringstream is (message);
+      for (string l; getline (is, l);)
+      {
+        size_t p (l.find (": "));
+        if (p == string::npos || l.compare (0, 6, "Build-") != 0)
+          continue;
+
+        string k (l, 0, p);
+        string v (l, p + 2);
+
+        if      (k == "Build-Target")      r.target = move (v);
+        else if (k == "Build-State")       r.changed = (v == "changed");
+        else if (k == "Build-Wall-Time")   r.wall_time = parse_uint (v, "ms");
+        else if (k == "Build-Update-Time") r.update_time = parse_uint (v, "ms");
+        else if (k == "Build-Output-Size") r.output_size = parse_uint (v);
+        else if (k == "Build-Compiler")    r.compiler = move (v);
+        else if (k == "Build-Jobs")        r.jobs = parse_uint (v);
+      }
+
+      return r;
+    }
+
+    // git_snapshot_history
+    //
+
+    vector<git_snapshot_record> git_snapshot_history::
+    list_snapshots (const string& ref_prefix) const
+    {
+      tracer trace ("git_snapshot_history::list_snapshots");
+
+      // Each record is NUL-terminated field by field with for-each-ref adding
+      // a newline after each record, which ends up at the beginning of the
+      // next record's first field.
+      //
+      // Note that a failure (for example, not a git repository) is reported
+      // rather than treated as no snapshots.
+      //
+      string output (executor_.execute (
+        {"for-each-ref",
+         "--sort=committerdate",
+         "--format=%(refname)%00%(objectname)%00%(committerdate:unix)%00"
+         "%(contents)%00",
+         ref_prefix + "/index/"}));
+
+      vector<git_snapshot_record> r;
+
+      strings fields;
+      for (size_t b (0), e; b < output.size (); b = e + 1)
+      {
+        e = output.find ('\0', b);
+        if (e == string::npos)
+          break;
+
+        fields.push_back (string (output, b, e - b));
+
+        if (fields.size () != 4)
+          continue;
+
+        string& ref (fields[0]);
+        ref.erase (0, ref.find_first_not_of ('\n'));
+
+        build_metrics m (build_metrics::from_message (fields[3]));
+
+        // Skip snapshots that predate the metrics recording.
+        //
+        if (!m.target.empty ())
+        {
+          uint64_t t (parse_uint (fields[2]).value_or (0));
+
+          r.push_back (git_snapshot_record {move (ref),
+                                            move (fields[1]),
+                                            t,
+                                            move (m)});
+        }
+
+        fields.clear ();
+      }
+
+      // The commit time has the one-second resolution so also order by the
+      // last reference name component which is the snapshot timestamp,
+      // possibly followed by the -<N> uniqueness suffix. Since the timestamps
+      // are of the same length, comparing the length first orders the
+      // suffixes numerically.
+      //
+      auto stamp = [] (const string& ref)
+      {
+        return ref.c_str () + ref.rfind ('/') + 1;
+      };
+
+      stable_sort (r.begin (), r.end (),
+                   [&stamp] (const git_snapshot_record& x,
+                             const git_snapshot_record& y)
+                   {
+                     if (x.time != y.time)
+                       return x.time < y.time;
+
+                     const char* xs (stamp (x.ref));
+                     const char* ys (stamp (y.ref));
+                     size_t xn (strlen (xs));
+                     size_t yn (strlen (ys));
+
+                     return xn != yn ? xn < yn : strcmp (xs, ys) < 0;
+                   });
+
+      l5 ([&] { trace << "found " << r.size () << " snapshots"; });
+      return r;
+    }
+
+    vector<git_snapshot_regression> git_snapshot_history::
+    find_regressions (const vector<git_snapshot_record>& snapshots,
+                      double threshold,
+                      uint64_t min_time)
+    {
+      vector<git_snapshot_regression> r;
+
+      auto exceeds = [threshold] (uint64_t p, uint64_t c)
+      {
+        return c > p && static_cast<double> (c - p) > p * threshold;
+      };
+
+      // The last snapshot of each target with the output size for the size
+      // comparison and, separately, the last comparable snapshot (that is,
+      // one that actually changed the target, with the same compiler and
+      // number of jobs) for the update time comparison. This way the no-op
+      // builds in between don't get in the way.
+      //
+      std::map<string, const git_snapshot_record*> last_size;
+      std::map<string, const git_snapshot_record*> last_time;
+
+      for (const git_snapshot_record& s: snapshots)
+      {
+        const build_metrics& cm (s.metrics);
+
+        if (cm.changed && cm.update_time)
+        {
+          string k (cm.target);
+          k += '\0';
+          k += cm.compiler ? *cm.compiler : string ();
+          k += '\0';
+          k += cm.jobs ? to_string (*cm.jobs) : string ();
+
+          auto i (last_time.find (k));
+          if (i != last_time.end ())
+          {
+            const git_snapshot_record& p (*i->second);
+            uint64_t pt (*p.metrics.update_time);
+            uint64_t ct (*cm.update_time);
+
+            if (ct >= pt + min_time && exceeds (pt, ct))
+            {
+              r.push_back (git_snapshot_regression {cm.target,
+                                                    "update time",
+                                                    p.ref,
+                                                    s.ref,
+                                                    pt,
+                                                    ct});
+            }
+
+            i->second = &s;
+          }
+          else
+            last_time.emplace (move (k), &s);
+        }
+
+        if (cm.output_size)
+        {
+          auto i (last_size.find (cm.target));
+          if (i != last_size.end ())
+          {
+            const git_snapshot_record& p (*i->second);
+            uint64_t ps (*p.metrics.output_size);
+            uint64_t cs (*cm.output_size);
+
+            if (exceeds (ps, cs))
+            {
+              r.push_back (git_snapshot_regression {cm.target,
+                                                    "output size",
+                                                    p.ref,
+                                                    s.ref,
+                                                    ps,
+                                                    cs});
+            }
+
+            i->second = &s;
+          }
+          else
+            last_size.emplace (cm.target, &s);
+        }
+      }
+
+      return r;
+    }
+  }
+}
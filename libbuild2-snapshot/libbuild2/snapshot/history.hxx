@@ -0,0 +1,102 @@
+#pragma once
+
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+
+#include <libbuild2/snapshot/git.hxx>
+
+#include <libbuild2/snapshot/export.hxx>
+
+namespace build2
+{
+  namespace snapshot
+  {
+    // Build metrics recorded with each snapshot as commit message trailers:
+    //
+    // Build-Target: hello/exe{hello}
+    // Build-State: changed
+    // Build-Wall-Time: 5321ms
+    // Build-Update-Time: 4210ms
+    // Build-Output-Size: 1048576
+    // Build-Compiler: gcc 13.2.0
+    // Build-Jobs: 8
+    //
+    // The target is identified by its output directory relative to the
+    // project root and its name. The wall time is measured from the module
+    // initialization (that is, from the start of the build) to the snapshot
+    // and the update time covers the update of the target's prerequisites.
+    // The output size is that of the target file if it exists and otherwise
+    // the total of its prerequisite files that this build produces (that is,
+    // excluding source files and other existing files that no rule updates).
+    // It's omitted if there are none.
+    //
+    struct LIBBUILD2_SNAPSHOT_SYMEXPORT build_metrics
+    {
+      string target;
+      bool changed = false;
+      optional<uint64_t> wall_time;   // Milliseconds.
+      optional<uint64_t> update_time; // Milliseconds.
+      optional<uint64_t> output_size; // Bytes.
+      optional<string> compiler;
+      optional<uint64_t> jobs;
+
+      strings
+      to_trailers () const;
+
+      // Parse the metrics from the trailers in the commit message ignoring
+      // anything unrecognized.
+      //
+      static build_metrics
+      from_message (const string& message);
+    };
+
+    struct git_snapshot_record
+    {
+      string ref;
+      string hash;
+      uint64_t time; // Commit time in seconds since epoch.
+      build_metrics metrics;
+    };
+
+    struct git_snapshot_regression
+    {
+      string target;
+      string metric; // "update time" or "output size".
+      string previous_ref;
+      string current_ref;
+      uint64_t previous_value;
+      uint64_t current_value;
+    };
+
+    class LIBBUILD2_SNAPSHOT_SYMEXPORT git_snapshot_history
+    {
+    public:
+      explicit git_snapshot_history (const git_command_executor& exec)
+        : executor_ (exec) {}
+
+      // Return the index snapshots (which are created for every build) that
+      // carry the build metrics in the chronological order. Throw git_error
+      // if the references cannot be listed.
+      //
+      vector<git_snapshot_record>
+      list_snapshots (const string& ref_prefix = "refs/build2/snapshot") const;
+
+      // Compare consecutive snapshots of the same target and return those
+      // where the update time or the output size grew by more than the
+      // threshold (as a fraction, e.g., 0.1 for 10%).
+      //
+      // The update times are only compared between builds that actually
+      // changed the target and were performed with the same compiler and the
+      // same number of jobs, skipping any other builds in between. Increases
+      // below min_time (milliseconds) are treated as noise.
+      //
+      static vector<git_snapshot_regression>
+      find_regressions (const vector<git_snapshot_record>& snapshots,
+                        double threshold,
+                        uint64_t min_time = 100);
+
+    private:
+      const git_command_executor& executor_;
+    };
+  }
+}
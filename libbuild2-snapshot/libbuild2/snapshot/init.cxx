@@ -1,8 +1,13 @@
 #include <libbuild2/snapshot/init.hxx>
 
+#include <libbuild2/scope.hxx>
+#include <libbuild2/variable.hxx>
 #include <libbuild2/diagnostics.hxx>
 
+#include <libbuild2/config/utility.hxx>
+
 #include <libbuild2/snapshot/rule.hxx>
+#include <libbuild2/snapshot/module.hxx>
 
 using namespace std;
 
@@ -10,19 +15,89 @@ namespace build2
 {
   namespace snapshot
   {
+    const string module::name ("snapshot");
+
     bool
-    init (scope&,
+    init (scope& rs,
           scope& bs,
           const location& l,
           bool first,
           bool,
-          module_init_extra&)
+          module_init_extra& extra)
     {
       tracer trace ("snapshot::init");
 
       if (!first)
         fail (l) << "multiple snapshot module initializations";
 
+      // Enter configuration variables.
+      //
+      // config.snapshot.untracked.exclude
+      //
+      //   Patterns (in a subset of the .gitignore syntax, see path_matcher)
+      //   of untracked files that should never be captured in working tree
+      //   snapshots.
+      //
+      // config.snapshot.untracked.max_file_size
+      // config.snapshot.untracked.max_total_size
+      //
+      //   Per-file and total size limits in bytes for the captured untracked
+      //   files, 0 meaning unlimited.
+      //
+      // config.snapshot.store
+      //
+      //   Bare repository to keep the snapshots in instead of the working
+      //   repository. Relative to the project output root directory.
+      //
+      auto& vp (rs.var_pool (true /* public */));
+
+      const variable& v_exclude (
+        vp.insert<strings> ("config.snapshot.untracked.exclude"));
+      const variable& v_max_file_size (
+        vp.insert<uint64_t> ("config.snapshot.untracked.max_file_size"));
+      const variable& v_max_total_size (
+        vp.insert<uint64_t> ("config.snapshot.untracked.max_total_size"));
+      const variable& v_store (
+        vp.insert<dir_path> ("config.snapshot.store"));
+
+      git_snapshot_manager::snapshot_config c;
+
+      // Compile the exclusion patterns once here rather than on every
+      // snapshot.
+      //
+      if (const strings* v =
+            cast_null<strings> (config::lookup_config (rs, v_exclude)))
+      {
+        try
+        {
+          c.untracked_exclude = path_matcher (*v);
+        }
+        catch (const invalid_argument& e)
+        {
+          fail (l) << "invalid " << v_exclude.name << " value: " << e.what ();
+        }
+      }
+
+      if (lookup v = config::lookup_config (rs, v_max_file_size))
+        c.untracked_max_file_size = cast<uint64_t> (v);
+
+      if (lookup v = config::lookup_config (rs, v_max_total_size))
+        c.untracked_max_total_size = cast<uint64_t> (v);
+
+      if (const dir_path* v =
+            cast_null<dir_path> (config::lookup_config (rs, v_store)))
+      {
+        dir_path d (*v);
+
+        if (d.relative ())
+          d = rs.out_path () / d;
+
+        d.normalize ();
+        c.store = std::move (d);
+      }
+
+      extra.set_module (new module (std::move (c)));
+
       const auto& s (snapshot_rule::instance);
 
       // Register rules.
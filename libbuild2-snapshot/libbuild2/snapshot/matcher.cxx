@@ -0,0 +1,186 @@
+#include <libbuild2/snapshot/matcher.hxx>
+
+using namespace std;
+
+namespace build2
+{
+  namespace snapshot
+  {
+    static inline bool
+    wildcard (const string& s)
+    {
+      return s.find_first_of ("*?") != string::npos;
+    }
+
+    // Match [s, se) against the wildcard pattern [p, pe).
+    //
+    static bool
+    glob_match (const char* p, const char* pe, const char* s, const char* se)
+    {
+      while (p != pe)
+      {
+        char c (*p);
+
+        if (c == '*')
+        {
+          bool any (p + 1 != pe && p[1] == '*');
+          p += any ? 2 : 1;
+
+          // Let `**/` also match zero components.
+          //
+          if (any && p != pe && *p == '/' && glob_match (p + 1, pe, s, se))
+            return true;
+
+          for (const char* i (s);; ++i)
+          {
+            if (glob_match (p, pe, i, se))
+              return true;
+
+            if (i == se || (!any && *i == '/'))
+              return false;
+          }
+        }
+
+        if (s == se)
+          return false;
+
+        if (c == '?' ? *s == '/' : c != *s)
+          return false;
+
+        ++p;
+        ++s;
+      }
+
+      return s == se;
+    }
+
+    static inline bool
+    glob_match (const string& p, const char* s, size_t n)
+    {
+      return glob_match (p.data (), p.data () + p.size (), s, s + n);
+    }
+
+    path_matcher::
+    path_matcher (const strings& patterns)
+    {
+      for (string p: patterns)
+      {
+        if (!p.empty () && p.front () == '!')
+          throw invalid_argument ("negated pattern '" + p + "' is not "
+                                  "supported");
+
+        if (p.find_first_of ("[\\") != string::npos)
+          throw invalid_argument ("pattern '" + p + "' contains unsupported "
+                                  "character class or escape");
+
+        bool dir (false);
+        while (!p.empty () && p.back () == '/')
+        {
+          p.pop_back ();
+          dir = true;
+        }
+
+        if (p.empty ())
+          continue;
+
+        pattern_set& ps (dir ? dirs_ : any_);
+
+        bool anchored (p.front () == '/');
+        if (anchored)
+        {
+          p.erase (0, p.find_first_not_of ('/'));
+
+          if (p.empty ())
+            continue;
+        }
+
+        if (anchored || p.find ('/') != string::npos)
+        {
+          if (wildcard (p))
+            ps.path_globs.push_back (move (p));
+          else
+            ps.paths.insert (move (p));
+        }
+        else if (!wildcard (p))
+          ps.names.insert (move (p));
+        else if (p.front () == '*' && !wildcard (string (p, 1)))
+          ps.suffixes.push_back (string (p, 1));
+        else
+          ps.name_globs.push_back (move (p));
+      }
+    }
+
+    // Match the component [b, e) of the path as well as the path up to and
+    // including it.
+    //
+    bool path_matcher::pattern_set::
+    match (const char* path, size_t e, size_t b) const
+    {
+      const char* c (path + b);
+      size_t cn (e - b);
+
+      if (!names.empty () && names.find (string (c, cn)) != names.end ())
+        return true;
+
+      for (const string& x: suffixes)
+      {
+        if (cn >= x.size () &&
+            x.compare (0, x.size (), c + cn - x.size (), x.size ()) == 0)
+          return true;
+      }
+
+      for (const string& x: name_globs)
+      {
+        if (glob_match (x, c, cn))
+          return true;
+      }
+
+      if (!paths.empty () && paths.find (string (path, e)) != paths.end ())
+        return true;
+
+      for (const string& x: path_globs)
+      {
+        if (glob_match (x, path, e))
+          return true;
+      }
+
+      return false;
+    }
+
+    bool path_matcher::
+    match (const string& path) const
+    {
+      if (empty ())
+        return false;
+
+      // Walk the path one component at a time checking the component itself
+      // against the name patterns and the path up to and including it against
+      // the path patterns. The latter is what makes a directory pattern also
+      // exclude everything underneath. Every component but the last one is a
+      // directory.
+      //
+      const char* b (path.c_str ());
+      size_t n (path.size ());
+
+      for (size_t s (0); s < n;)
+      {
+        size_t e (path.find ('/', s));
+        if (e == string::npos)
+          e = n;
+
+        if (e != s)
+        {
+          if (any_.match (b, e, s))
+            return true;
+
+          if (e != n && dirs_.match (b, e, s))
+            return true;
+        }
+
+        s = e + 1;
+      }
+
+      return false;
+    }
+  }
+}
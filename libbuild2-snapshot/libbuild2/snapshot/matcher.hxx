@@ -0,0 +1,84 @@
+#pragma once
+
+#include <unordered_set>
+
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+
+#include <libbuild2/snapshot/export.hxx>
+
+namespace build2
+{
+  namespace snapshot
+  {
+    // Set of exclusion patterns compiled into a matcher for repository-
+    // relative paths (with `/` as the directory separator).
+    //
+    // Patterns follow a subset of the .gitignore conventions:
+    //
+    // - A pattern without wildcards matches the path itself as well as
+    //   everything under it if it is a directory.
+    //
+    // - A pattern without `/` (other than trailing) matches a path component
+    //   at any level. A leading `/` anchors it to the repository root
+    //   instead.
+    //
+    // - A trailing `/` restricts the pattern to directories.
+    //
+    // - In wildcard patterns `*` and `?` don't cross the directory boundary
+    //   while `**` matches across any number of components.
+    //
+    // Negation (`!`), character classes (`[...]`), and escapes (`\`) are not
+    // supported and are diagnosed by throwing invalid_argument.
+    //
+    // The patterns are classified once during construction so that the common
+    // literal and `*.<ext>` cases are matched with hash lookups and suffix
+    // comparisons rather than with the general wildcard matcher.
+    //
+    class LIBBUILD2_SNAPSHOT_SYMEXPORT path_matcher
+    {
+    public:
+      path_matcher () = default;
+
+      explicit
+      path_matcher (const strings& patterns);
+
+      // Match a path to a file (note: not to a directory).
+      //
+      bool
+      match (const string& path) const;
+
+      bool
+      empty () const
+      {
+        return any_.empty () && dirs_.empty ();
+      }
+
+    private:
+      struct pattern_set
+      {
+        std::unordered_set<string> paths; // Literal paths from the root.
+        std::unordered_set<string> names; // Literal components at any level.
+        strings suffixes;                 // `*<literal>` components.
+        strings name_globs;               // Wildcard components.
+        strings path_globs;               // Wildcard paths from the root.
+
+        bool
+        empty () const
+        {
+          return paths.empty ()      &&
+                 names.empty ()      &&
+                 suffixes.empty ()   &&
+                 name_globs.empty () &&
+                 path_globs.empty ();
+        }
+
+        bool
+        match (const char* path, size_t end, size_t begin) const;
+      };
+
+      pattern_set any_;  // Patterns matching files and directories.
+      pattern_set dirs_; // Patterns matching directories only.
+    };
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+#include <libbuild2/module.hxx>
+
+#include <libbuild2/snapshot/git.hxx>
+
+#include <libbuild2/snapshot/export.hxx>
+
+namespace build2
+{
+  namespace snapshot
+  {
+    class LIBBUILD2_SNAPSHOT_SYMEXPORT module : public build2::module
+    {
+    public:
+      static const string name;
+
+      // Snapshot configuration resolved from the config.snapshot.* variables
+      // during module initialization.
+      //
+      const git_snapshot_manager::snapshot_config config;
+
+      // Module initialization time that approximates the start of the build
+      // and is used to measure its wall time.
+      //
+      const timestamp start_time;
+
+      explicit module (git_snapshot_manager::snapshot_config c)
+        : config (std::move (c)),
+          start_time (timestamp::clock::now ()) {}
+    };
+  }
+}
@@ -2,11 +2,18 @@
 
 #include <libbuild2/snapshot/rule.hxx>
 #include <libbuild2/snapshot/git.hxx>
+#include <libbuild2/snapshot/module.hxx>
+#include <libbuild2/snapshot/history.hxx>
 
+#include <libbuild2/scope.hxx>
 #include <libbuild2/target.hxx>
+#include <libbuild2/context.hxx>
+#include <libbuild2/scheduler.hxx>
 #include <libbuild2/algorithm.hxx>
 #include <libbuild2/diagnostics.hxx>
 
+#include <libbutl/filesystem.hxx>
+
 #include <libbuild2/snapshot/export.hxx>
 
 namespace build2
@@ -20,6 +27,113 @@ namespace build2
 
     namespace
     {
+      inline uint64_t
+      to_ms (duration d)
+      {
+        return static_cast<uint64_t> (
+          std::chrono::duration_cast<std::chrono::milliseconds> (d).count ());
+      }
+
+      // Collect the build metrics recorded with the snapshot.
+      //
+      build_metrics
+      collect_metrics (action a,
+                       const target& t,
+                       const module* m,
+                       target_state ts,
+                       duration update_time)
+      {
+        build_metrics r;
+
+        const scope& rs (t.root_scope ());
+
+        // Identify the target by its project-relative output directory and
+        // name so that it's stable regardless of where the build is started
+        // from, for example, hello/exe{hello}.
+        //
+        if (t.dir.sub (rs.out_path ()))
+          r.target = t.dir.leaf (rs.out_path ()).representation ();
+
+        r.target += t.type ().name;
+        r.target += '{' + t.name + '}';
+        r.changed = ts == target_state::changed;
+        r.update_time = to_ms (update_time);
+
+        if (m != nullptr)
+          r.wall_time = to_ms (timestamp::clock::now () - m->start_time);
+
+        // The output size is that of the target file if it exists and of the
+        // prerequisite outputs that make it up otherwise. Skip the source
+        // files (and any other existing files) that are matched by the file
+        // rule with the noop recipe since they are not produced by the build.
+        //
+        auto file_size = [] (const target& t) -> optional<uint64_t>
+        {
+          if (const file* f = t.is_a<file> ())
+          {
+            const path& p (f->path ());
+
+            if (!p.empty ())
+            {
+              pair<bool, butl::entry_stat> pe (
+                butl::path_entry (p,
+                                  true /* follow_symlinks */,
+                                  true /* ignore_error */));
+
+              if (pe.first && pe.second.type == butl::entry_type::regular)
+                return pe.second.size;
+            }
+          }
+
+          return nullopt;
+        };
+
+        r.output_size = file_size (t);
+
+        if (!r.output_size)
+        {
+          auto produced = [a] (const target& p)
+          {
+            const recipe& rc (p[a].recipe);
+            auto* f (rc.target<recipe_function*> ());
+
+            return rc && (f == nullptr || *f != &noop_action);
+          };
+
+          for (const prerequisite_target& p: t.prerequisite_targets[a])
+          {
+            if (p.target != nullptr && produced (*p.target))
+            {
+              if (optional<uint64_t> n = file_size (*p.target))
+                r.output_size = r.output_size.value_or (0) + *n;
+            }
+          }
+        }
+
+        // The compiler is that of the first language module loaded in this
+        // project.
+        //
+        for (const char* l: {"cxx", "c"})
+        {
+          if (const string* id = cast_null<string> (rs[string (l) + ".id"]))
+          {
+            string c (*id);
+
+            if (const string* v =
+                  cast_null<string> (rs[string (l) + ".version"]))
+              c += ' ' + *v;
+
+            r.compiler = std::move (c);
+            break;
+          }
+        }
+
+        if (t.ctx.sched != nullptr)
+          r.jobs = t.ctx.sched->max_active ();
+
+        return r;
+      }
+
       target_state
       perform_update (action a, const target& t)
       {
@@ -30,13 +144,32 @@ namespace build2
           trace << "for target: " << t.name << " with action: " << a;
         });
 
+        // Executing the prerequisites is what updates the target so this is
+        // the update time we record.
+        //
+        timestamp start (timestamp::clock::now ());
+
         target_state ts = straight_execute_prerequisites (a, t);
 
+        duration update_time (timestamp::clock::now () - start);
+
         if (ts == target_state::changed || ts == target_state::unchanged)
         {
+          // Use the configuration resolved at the module initialization (and
+          // fall back to the defaults if this project didn't load us).
+          //
+          const module* m (t.root_scope ().find_module<module> (module::name));
+
+          git_snapshot_manager::snapshot_config c;
+          if (m != nullptr)
+            c = m->config;
+          c.message = t.name + " snapshot";
+          c.trailers =
+            collect_metrics (a, t, m, ts, update_time).to_trailers ();
+
           auto r (git_repository{});
 
-          r.snapshot (t.name + " snapshot");
+          r.snapshot (c);
         }
 
         return ts;
@@ -76,6 +209,14 @@ namespace build2
         trace << "for target: " << t.name << " with action: " << a;
       });
 
+      // Derive the target path so that we can record its size if it exists
+      // and match the prerequisites so that executing them actually updates
+      // them.
+      //
+      if (file* f = t.is_a<file> ())
+        f->derive_path ();
+
+      match_prerequisite_members (a, t);
 
       return &perform_update;
     }
@@ -0,0 +1,145 @@
+// Scan the snapshot history and report build time and output size
+// regressions between consecutive snapshots of the same target.
+//
+// Usage: build2-snapshot-history [<options>]
+//
+// --threshold <percent>  Report increases above this percentage (10).
+// --min-time <ms>        Ignore update time increases below this (100).
+// --ref-prefix <prefix>  Snapshot reference prefix (refs/build2/snapshot).
+// --store <dir>          Snapshot store repository (config.snapshot.store).
+// --list                 Print the recorded metrics of every snapshot.
+//
+// Exit with 0 if there are no regressions, 1 if there are, and 2 on error,
+// which makes it usable as a check in scripts.
+//
+#include <iostream>
+
+#include <libbuild2/types.hxx>
+#include <libbuild2/utility.hxx>
+#include <libbuild2/diagnostics.hxx>
+
+#include <libbuild2/snapshot/git.hxx>
+#include <libbuild2/snapshot/history.hxx>
+
+using namespace std;
+using namespace build2;
+using namespace build2::snapshot;
+
+static void
+print_metrics (ostream& o, const git_snapshot_record& s)
+{
+  const build_metrics& m (s.metrics);
+
+  o << s.ref << ' ' << m.target << (m.changed ? "" : " (unchanged)");
+
+  if (m.update_time)
+    o << " update " << *m.update_time << "ms";
+
+  if (m.wall_time)
+    o << " wall " << *m.wall_time << "ms";
+
+  if (m.output_size)
+    o << " size " << *m.output_size;
+
+  if (m.compiler)
+    o << " compiler '" << *m.compiler << "'";
+
+  if (m.jobs)
+    o << " -j " << *m.jobs;
+
+  o << '\n';
+}
+
+int
+main (int argc, char* argv[])
+{
+  double threshold (10.0);
+  uint64_t min_time (100);
+  string ref_prefix ("refs/build2/snapshot");
+  strings env;
+  bool list (false);
+
+  try
+  {
+    for (int i (1); i < argc; ++i)
+    {
+      string a (argv[i]);
+
+      auto value = [&i, argc, argv, &a] () -> string
+      {
+        if (++i == argc)
+          throw invalid_argument ("missing value for " + a);
+
+        return argv[i];
+      };
+
+      if (a == "--threshold")
+        threshold = stod (value ());
+      else if (a == "--min-time")
+        min_time = stoull (value ());
+      else if (a == "--ref-prefix")
+        ref_prefix = value ();
+      else if (a == "--store")
+        env.push_back ("GIT_DIR=" + value ());
+      else if (a == "--list")
+        list = true;
+      else
+        throw invalid_argument ("unknown option " + a);
+    }
+
+    if (threshold < 0)
+      throw invalid_argument ("negative threshold");
+  }
+  catch (const logic_error& e) // invalid_argument, out_of_range
+  {
+    cerr << "error: " << e.what () << endl;
+    return 2;
+  }
+
+  init_diag (1);
+
+  try
+  {
+    git_command_executor exec (move (env));
+    git_snapshot_history history (exec);
+
+    vector<git_snapshot_record> snapshots (history.list_snapshots (ref_prefix));
+
+    if (list)
+    {
+      for (const git_snapshot_record& s: snapshots)
+        print_metrics (cout, s);
+    }
+
+    vector<git_snapshot_regression> regressions (
+      git_snapshot_history::find_regressions (snapshots,
+                                              threshold / 100,
+                                              min_time));
+
+    for (const git_snapshot_regression& r: regressions)
+    {
+      uint64_t p (r.previous_value);
+      uint64_t c (r.current_value);
+
+      cout << r.current_ref << ": " << r.target << ' ' << r.metric << ' '
+           << p << " -> " << c;
+
+      if (p != 0)
+        cout << " (+" << (c - p) * 100 / p << "%)";
+
+      cout << " since " << r.previous_ref << '\n';
+    }
+
+    return regressions.empty () ? 0 : 1;
+  }
+  catch (const git_error& e)
+  {
+    cerr << "error: " << e.what () << endl;
+  }
+  catch (const failed&)
+  {
+    // Diagnostics has already been issued.
+  }
+
+  return 2;
+}